@@ -0,0 +1,465 @@
+//
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2019 Andriy Berestovskyy <berestovskyy@gmail.com>
+//
+// Applied Benchmarks: Memory Blocking
+// Benchmarking cache blocking and tiling of strided 2D access
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "benchmark/benchmark.h"
+
+// User-defined literals
+auto constexpr operator""_B(unsigned long long int n) { return n; }
+auto constexpr operator""_KB(unsigned long long int n) { return n * 1024; }
+auto constexpr operator""_M(unsigned long long int n) { return n * 1000 * 1000; }
+
+// Cache line size: 64 bytes for x86-64, 128 bytes for A64 ARMs
+const auto kCachelineSize = 64_B;
+// Memory page size. Default page size is 4 KB
+const auto kPageSize = 4_KB;
+
+// Matrix element type
+using Element = float;
+// Leading dimension padding in elements: one cache line
+const auto kPadding = kCachelineSize / sizeof(Element);
+// Block size in elements to stop the cache-oblivious recursion at
+const auto kRecursionBlock = 16_B;
+// Tile sizes in elements to sweep
+const size_t kTiles[] = {4, 8, 16, 32, 64, 128, 256};
+
+//
+// Transpose a square matrix row by row.
+//
+// @param src
+//   Source matrix.
+// @param dst
+//   Destination matrix.
+// @param width
+//   Matrix width and height in elements.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+//
+static void transpose_rows(const Element *src, Element *dst,
+                           const size_t width, const size_t ld) {
+  for (size_t i = 0; i < width; i++)
+    for (size_t j = 0; j < width; j++) dst[j * ld + i] = src[i * ld + j];
+}
+
+//
+// Transpose a square matrix tile by tile.
+//
+// @param src
+//   Source matrix.
+// @param dst
+//   Destination matrix.
+// @param width
+//   Matrix width and height in elements.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+// @param tile
+//   Tile width and height in elements.
+//
+static void transpose_tiles(const Element *src, Element *dst,
+                            const size_t width, const size_t ld,
+                            const size_t tile) {
+  for (size_t ib = 0; ib < width; ib += tile) {
+    const auto i_end = std::min(ib + tile, width);
+    for (size_t jb = 0; jb < width; jb += tile) {
+      const auto j_end = std::min(jb + tile, width);
+      for (size_t i = ib; i < i_end; i++)
+        for (size_t j = jb; j < j_end; j++) dst[j * ld + i] = src[i * ld + j];
+    }
+  }
+}
+
+//
+// Transpose a block of a matrix splitting it in halves recursively.
+//
+// The cache-oblivious version: the halves fit each cache level
+// at some depth of the recursion, so there is no tile size to tune.
+//
+// @param src
+//   Source matrix.
+// @param dst
+//   Destination matrix.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+// @param row
+//   First row of the block.
+// @param col
+//   First column of the block.
+// @param rows
+//   Number of rows in the block.
+// @param cols
+//   Number of columns in the block.
+//
+static void transpose_halves(const Element *src, Element *dst,
+                             const size_t ld, const size_t row,
+                             const size_t col, const size_t rows,
+                             const size_t cols) {
+  if (rows <= kRecursionBlock && cols <= kRecursionBlock) {
+    for (size_t i = row; i < row + rows; i++)
+      for (size_t j = col; j < col + cols; j++)
+        dst[j * ld + i] = src[i * ld + j];
+  } else if (rows >= cols) {
+    transpose_halves(src, dst, ld, row, col, rows / 2, cols);
+    transpose_halves(src, dst, ld, row + rows / 2, col, rows - rows / 2, cols);
+  } else {
+    transpose_halves(src, dst, ld, row, col, rows, cols / 2);
+    transpose_halves(src, dst, ld, row, col + cols / 2, rows, cols - cols / 2);
+  }
+}
+
+//
+// Sum up each column of a square matrix walking down the columns.
+//
+// @param src
+//   Source matrix.
+// @param sums
+//   Column sums.
+// @param width
+//   Matrix width and height in elements.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+//
+static void sum_columns(const Element *src, Element *sums,
+                        const size_t width, const size_t ld) {
+  for (size_t j = 0; j < width; j++) {
+    Element sum = 0;
+    for (size_t i = 0; i < width; i++) sum += src[i * ld + j];
+    sums[j] = sum;
+  }
+}
+
+//
+// Sum up each column of a square matrix walking down a tile of columns.
+//
+// @param src
+//   Source matrix.
+// @param sums
+//   Column sums.
+// @param width
+//   Matrix width and height in elements.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+// @param tile
+//   Number of columns to sum up at once.
+//
+static void sum_column_tiles(const Element *src, Element *sums,
+                             const size_t width, const size_t ld,
+                             const size_t tile) {
+  std::fill(sums, sums + width, 0);
+  for (size_t jb = 0; jb < width; jb += tile) {
+    const auto j_end = std::min(jb + tile, width);
+    for (size_t i = 0; i < width; i++)
+      for (size_t j = jb; j < j_end; j++) sums[j] += src[i * ld + j];
+  }
+}
+
+//
+// Add up a block of a matrix to the column sums splitting it recursively.
+//
+// @param src
+//   Source matrix.
+// @param sums
+//   Column sums.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+// @param row
+//   First row of the block.
+// @param col
+//   First column of the block.
+// @param rows
+//   Number of rows in the block.
+// @param cols
+//   Number of columns in the block.
+//
+static void sum_column_halves(const Element *src, Element *sums,
+                              const size_t ld, const size_t row,
+                              const size_t col, const size_t rows,
+                              const size_t cols) {
+  if (rows <= kRecursionBlock && cols <= kRecursionBlock) {
+    for (size_t i = row; i < row + rows; i++)
+      for (size_t j = col; j < col + cols; j++) sums[j] += src[i * ld + j];
+  } else if (rows >= cols) {
+    sum_column_halves(src, sums, ld, row, col, rows / 2, cols);
+    sum_column_halves(src, sums, ld, row + rows / 2, col, rows - rows / 2,
+                      cols);
+  } else {
+    sum_column_halves(src, sums, ld, row, col, rows, cols / 2);
+    sum_column_halves(src, sums, ld, row, col + cols / 2, rows,
+                      cols - cols / 2);
+  }
+}
+
+//
+// Create and benchmark a kernel over a pair of square matrices.
+//
+// @tparam Kernel
+//   A kernel to benchmark.
+//
+// @param state
+//   Benchmark state object.
+// @param width
+//   Matrix width and height in elements.
+// @param ld
+//   Leading dimension, i.e. distance in elements between the rows.
+// @param bytes_per_element
+//   Number of bytes read and written by the kernel per matrix element.
+// @param kernel
+//   A kernel to run on the source and destination matrices.
+//
+template <class Kernel>
+void benchmark_matrix(benchmark::State &state, const size_t width,
+                      const size_t ld, const size_t bytes_per_element,
+                      Kernel kernel) {
+  assert(ld >= width);
+  // Allocate aligned chunks of memory
+  const auto memory_size = width * ld * sizeof(Element);
+  auto src = static_cast<Element *>(
+      operator new(memory_size, std::align_val_t(kPageSize)));
+  auto dst = static_cast<Element *>(
+      operator new(memory_size, std::align_val_t(kPageSize)));
+  std::fill(src, src + width * ld, 1);
+  std::fill(dst, dst + width * ld, 0);
+
+  // Each batch processes the whole matrix
+  const auto num_ops = width * width;
+  while (state.KeepRunningBatch(num_ops)) {
+    kernel(src, dst);
+    benchmark::DoNotOptimize(dst);
+    benchmark::ClobberMemory();
+  }
+
+  operator delete(src, std::align_val_t(kPageSize));
+  operator delete(dst, std::align_val_t(kPageSize));
+
+  state.counters["Rate"] = benchmark::Counter(
+      state.iterations() * bytes_per_element, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+
+// Fastest tile size of a width and its time measured by the tiled sweep
+struct BestTile {
+  double time;
+  size_t tile;
+};
+// Fastest tile sizes by the sweep benchmark name and the width
+static std::map<std::pair<std::string, size_t>, BestTile> best_tiles;
+
+//
+// Console reporter recording the fastest tile size of each width
+// measured by the tiled sweep.
+//
+class BestTileReporter : public benchmark::ConsoleReporter {
+ public:
+  using ConsoleReporter::ConsoleReporter;
+
+  void ReportRuns(const std::vector<Run> &runs) override {
+    ConsoleReporter::ReportRuns(runs);
+    for (const auto &run : runs) {
+      size_t width, tile;
+      if (run.error_occurred || run.run_type != Run::RT_Iteration ||
+          std::sscanf(run.run_name.args.c_str(), "width:%zu/tile:%zu", &width,
+                      &tile) != 2) {
+        continue;
+      }
+      const auto time = run.GetAdjustedRealTime();
+      auto &best = best_tiles[{run.run_name.function_name, width}];
+      if (best.tile == 0 || time < best.time) best = {time, tile};
+    }
+  }
+};
+
+//
+// Get the fastest tile size measured by a tiled sweep.
+//
+// @param sweep
+//   Tiled sweep benchmark name.
+// @param width
+//   Matrix width and height in elements.
+//
+// @return
+//   The fastest tile size in elements or zero if the width
+//   was not swept.
+//
+static size_t best_tile(const std::string &sweep, const size_t width) {
+  const auto best = best_tiles.find({sweep, width});
+  return best == best_tiles.end() ? 0 : best->second.tile;
+}
+
+//
+// Generate matrix widths: the power-of-two widths for each cache level
+// (16 KB, 256 KB, 4 MB and 64 MB matrices) and the widths next to them.
+//
+static void width_args(benchmark::internal::Benchmark *b) {
+  b->ArgName("width");
+  for (auto width : {64, 256, 1024, 4096}) {
+    b->Arg(width - 1);
+    b->Arg(width);
+    b->Arg(width + 1);
+  }
+}
+
+//
+// Generate matrix widths of the `width_args` times tile sizes.
+//
+static void width_tile_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"width", "tile"});
+  for (auto width : {64, 256, 1024, 4096}) {
+    for (auto w : {width - 1, width, width + 1}) {
+      for (auto tile : kTiles) {
+        if (tile > size_t(w)) break;
+        b->Args({w, int64_t(tile)});
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+// Transpose
+////////////////////////////////////////////////////////////////////////
+
+static void transpose_naive(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  benchmark_matrix(state, width, width, 2 * sizeof(Element),
+                   [width](const Element *src, Element *dst) {
+                     transpose_rows(src, dst, width, width);
+                   });
+}
+BENCHMARK(transpose_naive)->Apply(width_args);
+
+static void transpose_padded(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+  const auto ld = width + kPadding;
+
+  benchmark_matrix(state, width, ld, 2 * sizeof(Element),
+                   [width, ld](const Element *src, Element *dst) {
+                     transpose_rows(src, dst, width, ld);
+                   });
+}
+BENCHMARK(transpose_padded)->Apply(width_args);
+
+static void transpose_tiled(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+  const auto tile = operator""_B(state.range(1));
+
+  benchmark_matrix(state, width, width, 2 * sizeof(Element),
+                   [width, tile](const Element *src, Element *dst) {
+                     transpose_tiles(src, dst, width, width, tile);
+                   });
+}
+BENCHMARK(transpose_tiled)->Apply(width_tile_args);
+
+static void transpose_best_tiled(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  // Rerun the fastest tile of the sweep, which runs first
+  const auto tile = best_tile("transpose_tiled", width);
+  if (tile == 0) {
+    state.SkipWithError("No transpose_tiled results for the width");
+    return;
+  }
+  benchmark_matrix(state, width, width, 2 * sizeof(Element),
+                   [width, tile](const Element *src, Element *dst) {
+                     transpose_tiles(src, dst, width, width, tile);
+                   });
+
+  state.counters["Tile"] = tile;
+}
+BENCHMARK(transpose_best_tiled)->Apply(width_args);
+
+static void transpose_recursive(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  benchmark_matrix(state, width, width, 2 * sizeof(Element),
+                   [width](const Element *src, Element *dst) {
+                     transpose_halves(src, dst, width, 0, 0, width, width);
+                   });
+}
+BENCHMARK(transpose_recursive)->Apply(width_args);
+
+////////////////////////////////////////////////////////////////////////
+// Column Sum
+////////////////////////////////////////////////////////////////////////
+
+static void column_sum_naive(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  benchmark_matrix(state, width, width, sizeof(Element),
+                   [width](const Element *src, Element *sums) {
+                     sum_columns(src, sums, width, width);
+                   });
+}
+BENCHMARK(column_sum_naive)->Apply(width_args);
+
+static void column_sum_padded(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+  const auto ld = width + kPadding;
+
+  benchmark_matrix(state, width, ld, sizeof(Element),
+                   [width, ld](const Element *src, Element *sums) {
+                     sum_columns(src, sums, width, ld);
+                   });
+}
+BENCHMARK(column_sum_padded)->Apply(width_args);
+
+static void column_sum_tiled(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+  const auto tile = operator""_B(state.range(1));
+
+  benchmark_matrix(state, width, width, sizeof(Element),
+                   [width, tile](const Element *src, Element *sums) {
+                     sum_column_tiles(src, sums, width, width, tile);
+                   });
+}
+BENCHMARK(column_sum_tiled)->Apply(width_tile_args);
+
+static void column_sum_best_tiled(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  // Rerun the fastest tile of the sweep, which runs first
+  const auto tile = best_tile("column_sum_tiled", width);
+  if (tile == 0) {
+    state.SkipWithError("No column_sum_tiled results for the width");
+    return;
+  }
+  benchmark_matrix(state, width, width, sizeof(Element),
+                   [width, tile](const Element *src, Element *sums) {
+                     sum_column_tiles(src, sums, width, width, tile);
+                   });
+
+  state.counters["Tile"] = tile;
+}
+BENCHMARK(column_sum_best_tiled)->Apply(width_args);
+
+static void column_sum_recursive(benchmark::State &state) {
+  const auto width = operator""_B(state.range(0));
+
+  benchmark_matrix(state, width, width, sizeof(Element),
+                   [width](const Element *src, Element *sums) {
+                     std::fill(sums, sums + width, 0);
+                     sum_column_halves(src, sums, width, 0, 0, width, width);
+                   });
+}
+BENCHMARK(column_sum_recursive)->Apply(width_args);
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  // Color the output just on a terminal, like the default reporter
+  BestTileReporter reporter(isatty(STDOUT_FILENO)
+                                ? benchmark::ConsoleReporter::OO_ColorTabular
+                                : benchmark::ConsoleReporter::OO_Tabular);
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  benchmark::Shutdown();
+  return 0;
+}
@@ -5,8 +5,23 @@
 // Applied Benchmarks: Memory Loads
 //
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 #include "benchmark/benchmark.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 // User-defined literals
 auto constexpr operator""_B(unsigned long long int n) { return n; }
@@ -18,6 +33,329 @@ const auto kCachelineSize = 64_B;
 // Memory page size. Default page size is 4 KB
 const auto kPageSize = 4_KB;
 
+//
+// Parse a list of ranges used in sysfs, i.e. "0-3,8,10-11".
+//
+// @param list
+//   A string with the list to parse.
+//
+// @return
+//   Array of numbers in the list.
+//
+static auto parse_sysfs_list(const std::string &list) {
+  std::vector<int> numbers;
+  std::istringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    const auto dash = range.find('-');
+    const auto first = std::stoi(range.substr(0, dash));
+    const auto last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (auto number = first; number <= last; number++)
+      numbers.push_back(number);
+  }
+  return numbers;
+}
+
+//
+// Read a list of ranges from a sysfs file.
+//
+// @param path
+//   Path to the sysfs file.
+//
+// @return
+//   Array of numbers in the list or an empty array on error.
+//
+static auto read_sysfs_list(const std::string &path) {
+  std::ifstream file(path);
+  std::string list;
+  if (!std::getline(file, list)) return std::vector<int>();
+  return parse_sysfs_list(list);
+}
+
+//
+// Get the online NUMA nodes.
+//
+// @return
+//   Array of NUMA nodes or just node 0 if the topology is not available.
+//
+static auto numa_nodes() {
+  auto nodes = read_sysfs_list("/sys/devices/system/node/online");
+  if (nodes.empty()) nodes.push_back(0);
+  return nodes;
+}
+
+// Memory node to use the default first touch NUMA policy
+const auto kFirstTouchNode = -1;
+// Memory node to interleave the pages over all the NUMA nodes
+const auto kInterleaveNodes = -2;
+
+//
+// Bind a memory range to a NUMA node or interleave it over the nodes.
+//
+// Calls `mbind(2)` directly, so there is no dependency on libnuma.
+//
+// @param memory
+//   A page-aligned memory range, not touched yet.
+// @param memory_size
+//   Memory range size in bytes.
+// @param mem_node
+//   NUMA node to bind the memory to or `kInterleaveNodes`.
+//
+// @return
+//   True on success.
+//
+static bool bind_memory(void *memory, const size_t memory_size,
+                        const int mem_node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  // See MPOL_BIND and MPOL_INTERLEAVE in linux/mempolicy.h
+  const auto kMpolBind = 2;
+  const auto kMpolInterleave = 3;
+  unsigned long nodemask = 0;
+  const auto kMaxNode = sizeof(nodemask) * 8;
+  if (mem_node == kInterleaveNodes) {
+    for (auto node : numa_nodes())
+      if (node < int(kMaxNode)) nodemask |= 1UL << node;
+  } else if (mem_node >= 0 && mem_node < int(kMaxNode)) {
+    nodemask = 1UL << mem_node;
+  }
+  if (nodemask == 0) return false;
+  // The kernel reads maxnode - 1 bits of the mask
+  return syscall(SYS_mbind, memory, memory_size,
+                 mem_node == kInterleaveNodes ? kMpolInterleave : kMpolBind,
+                 &nodemask, kMaxNode + 1, 0) == 0;
+#else
+  (void)memory, (void)memory_size, (void)mem_node;
+  return false;
+#endif
+}
+
+//
+// Get a page frame number for a virtual address.
+//
+// The kernel exposes the page frame numbers in `/proc/self/pagemap`
+// only to the processes with `CAP_SYS_ADMIN`, otherwise they read as zero.
+//
+// @param pagemap_fd
+//   File descriptor of the opened `/proc/self/pagemap`.
+// @param addr
+//   Virtual address of a page to look up. The page must be present.
+//
+// @return
+//   Page frame number or zero if it is not available.
+//
+static uint64_t virtual_to_pfn(const int pagemap_fd, const void *addr) {
+  // Each pagemap entry is 64 bits: bit 63 is page present, bits 0-54 are PFN
+  uint64_t entry;
+  const auto entry_offset =
+      reinterpret_cast<uintptr_t>(addr) / kPageSize * sizeof(entry);
+  if (pread(pagemap_fd, &entry, sizeof(entry), entry_offset) != sizeof(entry))
+    return 0;
+  if ((entry >> 63) == 0) return 0;
+  return entry & ((1ULL << 55) - 1);
+}
+
+// Result of mapping a physically colored memory block
+enum ColoringStatus {
+  kColored,
+  kPfnsHidden,
+  kNotEnoughPages,
+  kBindingFailed,
+  kMappingFailed
+};
+
+//
+// Map a memory block with the physical page colors of a contiguous block.
+//
+// The color of a page is a part of its physical address used as a cache
+// set index: pages of the same color compete for the same sets, while
+// pages of different colors never collide. The pages are picked from
+// a larger pool by their page frame numbers and moved into place with
+// `mremap(2)`, so the virtual stride of `set_stride` bytes maps to the
+// same physical L2/L3 set, just like in a physically contiguous block.
+//
+// @param memory_size
+//   Memory block size in bytes.
+// @param mem_node
+//   NUMA node to allocate the pages on or `kFirstTouchNode`.
+// @param set_stride
+//   Number of cache sets times the cache line size, i.e. the distance
+//   in bytes between two physical addresses mapped to the same set.
+// @param status
+//   Result of the mapping.
+//
+// @return
+//   Pointer to the memory block or nullptr on error.
+//
+static std::byte *map_colored_memory(const size_t memory_size,
+                                     const int mem_node,
+                                     const size_t set_stride,
+                                     ColoringStatus &status) {
+  status = kMappingFailed;
+#if defined(__linux__) && defined(MREMAP_FIXED)
+  assert(set_stride % kPageSize == 0);
+  const auto colors = set_stride / kPageSize;
+  const auto pages = (memory_size + kPageSize - 1) / kPageSize;
+
+  const auto pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+  if (pagemap_fd < 0) {
+    status = kPfnsHidden;
+    return nullptr;
+  }
+  // Reserve a virtual range to move the picked pages into
+  auto memory = static_cast<std::byte *>(
+      mmap(nullptr, pages * kPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+           -1, 0));
+  if (memory == MAP_FAILED) {
+    close(pagemap_fd);
+    return nullptr;
+  }
+
+  // Retry with a larger pool if there are not enough pages of some color
+  for (auto attempt = 1; attempt <= 4; attempt++) {
+    const auto pool_pages = (pages + colors) << attempt;
+    const auto pool_size = pool_pages * kPageSize;
+    auto pool = static_cast<std::byte *>(
+        mmap(nullptr, pool_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (pool == MAP_FAILED) {
+      status = kMappingFailed;
+      break;
+    }
+#if defined(MADV_NOHUGEPAGE)
+    // The pages are moved one by one, so do not split huge pages
+    madvise(pool, pool_size, MADV_NOHUGEPAGE);
+#endif
+    if (mem_node != kFirstTouchNode &&
+        !bind_memory(pool, pool_size, mem_node)) {
+      munmap(pool, pool_size);
+      status = kBindingFailed;
+      break;
+    }
+
+    // Sort the pool pages by color
+    std::vector<std::vector<size_t>> color_pages(colors);
+    status = kNotEnoughPages;
+    for (size_t page = 0; page < pool_pages; page++) {
+      // Make sure the page is present
+      pool[page * kPageSize] = std::byte{0};
+      const auto pfn = virtual_to_pfn(pagemap_fd, &pool[page * kPageSize]);
+      if (pfn == 0) {
+        status = kPfnsHidden;
+        break;
+      }
+      color_pages[pfn % colors].push_back(page);
+    }
+    // Page N of the block must have color N modulo the number of colors
+    for (size_t color = 0; color < colors && status == kNotEnoughPages;
+         color++) {
+      const auto color_needed = pages / colors + (color < pages % colors);
+      if (color_pages[color].size() < color_needed) break;
+      if (color == colors - 1) status = kColored;
+    }
+    for (size_t page = 0; page < pages && status == kColored; page++) {
+      auto &from = color_pages[page % colors];
+      if (mremap(&pool[from.back() * kPageSize], kPageSize, kPageSize,
+                 MREMAP_MAYMOVE | MREMAP_FIXED,
+                 &memory[page * kPageSize]) == MAP_FAILED) {
+        status = kMappingFailed;
+      }
+      from.pop_back();
+    }
+    // Unmap the rest of the pool
+    munmap(pool, pool_size);
+    if (status != kNotEnoughPages) break;
+  }
+  close(pagemap_fd);
+
+  if (status == kColored) return memory;
+  munmap(memory, pages * kPageSize);
+#else
+  (void)memory_size, (void)mem_node, (void)set_stride;
+#endif
+  return nullptr;
+}
+
+//
+// Allocate a page-aligned chunk of memory on a NUMA node.
+//
+// If the page frame numbers are hidden, the colored memory falls back
+// to the virtual placement, labeling the benchmark result. Mapping or
+// binding errors skip the benchmark.
+//
+// @param state
+//   Benchmark state object.
+// @param memory_size
+//   Memory size in bytes.
+// @param mem_node
+//   NUMA node to allocate the memory on, `kInterleaveNodes`
+//   or `kFirstTouchNode` for the default policy.
+// @param color_stride
+//   Number of cache sets times the cache line size to map the memory
+//   with the physical page colors of a contiguous block, or zero.
+//
+// @return
+//   Pointer to the memory or nullptr on error.
+//
+static std::byte *allocate_memory(benchmark::State &state,
+                                  const size_t memory_size, const int mem_node,
+                                  const size_t color_stride) {
+  std::byte *memory;
+  if (color_stride > kPageSize) {
+    ColoringStatus status;
+    memory = map_colored_memory(memory_size, mem_node, color_stride, status);
+    if (memory) return memory;
+    switch (status) {
+      case kPfnsHidden:
+        state.SetLabel("PFNs hidden, virtual placement");
+        break;
+      case kNotEnoughPages:
+        state.SkipWithError("Not enough pages of the same color");
+        return nullptr;
+      case kBindingFailed:
+        state.SkipWithError("Error binding memory to the NUMA node");
+        return nullptr;
+      default:
+        state.SkipWithError("Error mapping colored pages");
+        return nullptr;
+    }
+  }
+  if (mem_node == kFirstTouchNode && color_stride == 0) {
+    memory = static_cast<std::byte *>(
+        operator new(memory_size, std::align_val_t(kPageSize)));
+  } else {
+    // Map the memory, so the policy applies to the whole range
+    memory = static_cast<std::byte *>(mmap(nullptr, memory_size,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (memory == MAP_FAILED) {
+      state.SkipWithError("Error mapping memory");
+      return nullptr;
+    }
+    if (mem_node != kFirstTouchNode &&
+        !bind_memory(memory, memory_size, mem_node)) {
+      munmap(memory, memory_size);
+      state.SkipWithError("Error binding memory to the NUMA node");
+      return nullptr;
+    }
+  }
+  assert(reinterpret_cast<uintptr_t>(memory) % kPageSize == 0);
+  return memory;
+}
+
+//
+// Free a chunk of memory allocated with `allocate_memory`.
+//
+static void free_memory(std::byte *memory, const size_t memory_size,
+                        const int mem_node, const size_t color_stride) {
+  if (mem_node == kFirstTouchNode && color_stride == 0) {
+    operator delete(memory, std::align_val_t(kPageSize));
+  } else {
+    munmap(memory, memory_size);
+  }
+}
+
 //
 // Place list nodes in memory with the specified stride and offset.
 //
@@ -83,6 +421,45 @@ static auto place_list_nodes(std::byte *memory, const size_t memory_size,
   return list_head;
 }
 
+//
+// Place list nodes in memory at the specified offsets.
+//
+// Unlike `place_list_nodes`, the order of nodes is fully defined
+// by the caller, so any access pattern might be expressed.
+//
+// @tparam ListNode
+//   List node type.
+//
+// @param memory
+//   A memory block to place nodes in.
+// @param memory_size
+//   Total memory block size in bytes.
+// @param offsets
+//   Offsets in bytes of list nodes in the order of traversal.
+//
+// @return
+//   Pointer to the list head.
+//
+template <class ListNode>
+static auto place_list_nodes_at(std::byte *memory, const size_t memory_size,
+                                const std::vector<size_t> &offsets) {
+  assert(!offsets.empty());
+
+  ListNode *list_head = nullptr;
+  ListNode **cur_node_ptr = &list_head;
+  for (auto offset : offsets) {
+    // Check bounds
+    assert(offset + sizeof(ListNode) <= memory_size);
+    // Place a new list node at the offset
+    *cur_node_ptr = reinterpret_cast<ListNode *>(&memory[offset]);
+    cur_node_ptr = &(*cur_node_ptr)->next;
+  }
+  // Make a cycle
+  *cur_node_ptr = list_head;
+
+  return list_head;
+}
+
 //
 // Traverse the list and apply an operation on each node.
 //
@@ -227,16 +604,21 @@ end:
 //   Initial offset in bytes to place the first list node.
 // @param op
 //   An operation to perform on each node.
+// @param mem_node
+//   NUMA node to allocate the memory block on.
+// @param color_stride
+//   Number of cache sets times the cache line size to place the memory
+//   block pages by physical color, or zero for the virtual placement.
 //
 template <class ListNode, class Operation>
 void benchmark_list(benchmark::State &state, const size_t memory_size,
                     const size_t max_nodes, const size_t num_ops,
                     const size_t stride, const size_t start_offset,
-                    Operation op) {
+                    Operation op, const int mem_node = kFirstTouchNode,
+                    const size_t color_stride = 0) {
   // Allocate an aligned chunk of memory
-  auto memory = static_cast<std::byte *>(operator new(
-      memory_size, std::align_val_t(kPageSize)));
-  assert(reinterpret_cast<uintptr_t>(memory) % kPageSize == 0);
+  auto memory = allocate_memory(state, memory_size, mem_node, color_stride);
+  if (!memory) return;
 
   const auto list_head = place_list_nodes<ListNode>(
       memory, memory_size, max_nodes, stride, start_offset);
@@ -245,7 +627,51 @@ void benchmark_list(benchmark::State &state, const size_t memory_size,
     benchmark::DoNotOptimize(traverse_list(list_head, num_ops, op));
   }
 
-  operator delete(memory, std::align_val_t(kPageSize));
+  free_memory(memory, memory_size, mem_node, color_stride);
+}
+
+//
+// Create and benchmark a list of nodes placed at the specified offsets.
+//
+// @tparam ListNode
+//   List node type.
+// @tparam Operation
+//   An operation to perform on each list node.
+//
+// @param state
+//   Benchmark state object.
+// @param memory_size
+//   Total memory block size in bytes.
+// @param offsets
+//   Offsets in bytes of list nodes in the order of traversal.
+// @param num_ops
+//   Number of operations to perform per benchmark.
+// @param op
+//   An operation to perform on each node.
+// @param mem_node
+//   NUMA node to allocate the memory block on.
+// @param color_stride
+//   Number of cache sets times the cache line size to place the memory
+//   block pages by physical color, or zero for the virtual placement.
+//
+template <class ListNode, class Operation>
+void benchmark_list_at(benchmark::State &state, const size_t memory_size,
+                       const std::vector<size_t> &offsets,
+                       const size_t num_ops, Operation op,
+                       const int mem_node = kFirstTouchNode,
+                       const size_t color_stride = 0) {
+  // Allocate an aligned chunk of memory
+  auto memory = allocate_memory(state, memory_size, mem_node, color_stride);
+  if (!memory) return;
+
+  const auto list_head =
+      place_list_nodes_at<ListNode>(memory, memory_size, offsets);
+
+  while (state.KeepRunningBatch(num_ops)) {
+    benchmark::DoNotOptimize(traverse_list(list_head, num_ops, op));
+  }
+
+  free_memory(memory, memory_size, mem_node, color_stride);
 }
 
 //
@@ -270,16 +696,21 @@ void benchmark_list(benchmark::State &state, const size_t memory_size,
 //   Initial offset in bytes to place the first array element.
 // @param op
 //   An operation to perform on each element.
+// @param mem_node
+//   NUMA node to allocate the memory block on.
+// @param color_stride
+//   Number of cache sets times the cache line size to place the memory
+//   block pages by physical color, or zero for the virtual placement.
 //
 template <class ArrayElement, class Operation>
 void benchmark_array(benchmark::State &state, const size_t memory_size,
                      const size_t max_elements, const size_t num_ops,
                      const size_t stride, const size_t start_offset,
-                     Operation op) {
+                     Operation op, const int mem_node = kFirstTouchNode,
+                     const size_t color_stride = 0) {
   // Allocate an aligned chunk of memory
-  auto memory = static_cast<std::byte *>(operator new(
-      memory_size, std::align_val_t(kPageSize)));
-  assert(reinterpret_cast<uintptr_t>(memory) % kPageSize == 0);
+  auto memory = allocate_memory(state, memory_size, mem_node, color_stride);
+  if (!memory) return;
 
   place_array_elements<ArrayElement>(memory, memory_size, max_elements, stride,
                                      start_offset);
@@ -290,7 +721,7 @@ void benchmark_array(benchmark::State &state, const size_t memory_size,
     benchmark::DoNotOptimize(sum);
   }
 
-  operator delete(memory, std::align_val_t(kPageSize));
+  free_memory(memory, memory_size, mem_node, color_stride);
 }
 
 ////////////////////////////////////////////////////////////////////////
@@ -431,6 +862,312 @@ BENCHMARK(cache_associativity_list)
 //       [](CachelineAlignedArrayElement *) {});
 // }
 
+////////////////////////////////////////////////////////////////////////
+// Physical Page Placement
+////////////////////////////////////////////////////////////////////////
+
+// Physical placement of the list pages
+enum PagePlacement { kVirtualPages, kSameColorPages, kDistinctColorPages };
+
+//
+// Cache associativity with the list pages placed by physical color.
+//
+// With `kSameColorPages` the nodes are `set_stride` bytes apart in
+// a physically colored block, so they compete for the same physical
+// L2/L3 set, so the latency steps up once the number of ways is exceeded.
+// `kDistinctColorPages` is a baseline: the nodes are a page and a cache
+// line apart, so each node has the next page color and the next line
+// within its page, and up to `set_stride / kCachelineSize` nodes never
+// share a set. The L3 slice is selected by an undocumented hash of
+// the physical address, so at L3 the same color pages still spread
+// over the slices.
+//
+static void cache_associativity_physical_list(benchmark::State &state) {
+  const auto set_stride = operator""_KB(state.range(0));
+  const auto ways = operator""_B(state.range(1));
+  const auto placement = static_cast<PagePlacement>(state.range(2));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+
+  // One node per page: a page of each color in turn, skewed by a cache
+  // line for the distinct colors, or pages of the same color
+  // `set_stride` bytes apart
+  const auto stride = placement == kDistinctColorPages
+                          ? kPageSize + kCachelineSize
+                          : set_stride;
+  const auto color_stride = placement == kVirtualPages ? 0 : set_stride;
+  benchmark_list<CachelineAlignedListNode>(
+      state, ways * stride, ways, 1_M, stride, 0,
+      [](CachelineAlignedListNode *) {}, kFirstTouchNode, color_stride);
+  state.counters["List Size"] =
+      benchmark::Counter(ways * kCachelineSize, benchmark::Counter::kDefaults,
+                         benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(cache_associativity_physical_list)
+    ->ArgNames({"stride KB", "ways", "placement"})
+    // 1024 and 2048 sets: L2 sets or L3 sets per slice
+    ->ArgsProduct({{64, 128},
+                   {2, 4, 8, 12, 16, 20, 24, 32, 64, 128, 256},
+                   {kVirtualPages, kSameColorPages, kDistinctColorPages}})
+    //
+    ;
+
+////////////////////////////////////////////////////////////////////////
+// Cache Replacement Policy
+////////////////////////////////////////////////////////////////////////
+
+// Huge page size. Default transparent huge page size is 2 MB
+const auto kHugePageSize = 2_KB * 1_KB;
+
+//
+// Traverse a sequence of cache lines using dependent loads.
+//
+// A list would not do here, as a cache line might be re-referenced
+// in the sequence followed by a different cache line each time.
+// Instead, each cache line holds a zero, which is added to the next
+// offset, so each load still waits for the previous one to complete.
+//
+// @param memory
+//   A memory block of zero-initialized cache lines.
+// @param sequence
+//   Offsets in bytes of cache lines in the order of traversal.
+// @param sequence_size
+//   Number of offsets in the sequence.
+// @param num_ops
+//   Number of operations to perform.
+//
+static auto traverse_sequence(const std::byte *memory,
+                              const uint32_t *sequence,
+                              const size_t sequence_size, size_t num_ops) {
+  uintptr_t next = 0;
+  while (num_ops) {
+    for (size_t i = 0; i < sequence_size && num_ops; i++, num_ops--) {
+      next = *reinterpret_cast<const uintptr_t *>(&memory[sequence[i] + next]);
+    }
+  }
+  return next;
+}
+
+//
+// Check if a memory range is backed by transparent huge pages.
+//
+// `madvise(MADV_HUGEPAGE)` makes the range a separate mapping, so its
+// `AnonHugePages` in `/proc/self/smaps` must cover the whole range.
+//
+// @param memory
+//   A huge page aligned memory range advised with `MADV_HUGEPAGE`.
+// @param memory_size
+//   Memory range size in bytes.
+//
+// @return
+//   True if the whole range is backed by huge pages.
+//
+static bool huge_page_backed(const void *memory, const size_t memory_size) {
+  std::ostringstream range;
+  range << std::hex << reinterpret_cast<uintptr_t>(memory) << '-';
+  std::ifstream smaps("/proc/self/smaps");
+  std::string line;
+  auto found = false;
+  while (std::getline(smaps, line)) {
+    if (!found) {
+      found = line.compare(0, range.str().size(), range.str()) == 0;
+    } else if (line.compare(0, 14, "AnonHugePages:") == 0) {
+      return std::stoull(line.substr(14)) * 1_KB >= memory_size;
+    }
+  }
+  return false;
+}
+
+//
+// Create and benchmark a sequence of cache lines mapped to the same set.
+//
+// The lines are placed `set_stride` bytes apart, so for the cache level
+// with `set_stride` equal to the number of sets times the cache line size
+// all the lines compete for the same set. The strides above the page size
+// need a physically colored block. If the page frame numbers are hidden,
+// the memory is advised to be backed by transparent huge pages instead,
+// and the result is labeled if it is not.
+//
+// @param state
+//   Benchmark state object.
+// @param set_stride
+//   Distance in bytes between the cache lines in the same set.
+// @param lines
+//   Cache line numbers in the order of traversal.
+//
+static void benchmark_sequence(benchmark::State &state, const size_t set_stride,
+                               const std::vector<size_t> &lines) {
+  const auto num_lines = *std::max_element(lines.begin(), lines.end()) + 1;
+  const auto memory_size =
+      (num_lines * set_stride + kHugePageSize - 1) / kHugePageSize *
+      kHugePageSize;
+
+  std::byte *memory = nullptr;
+  if (set_stride > kPageSize) {
+    ColoringStatus status;
+    memory = map_colored_memory(memory_size, kFirstTouchNode, set_stride,
+                                status);
+  }
+  const auto colored = memory != nullptr;
+  if (!colored) {
+    // Allocate a huge page aligned chunk of memory
+    memory = static_cast<std::byte *>(operator new(
+        memory_size, std::align_val_t(kHugePageSize)));
+    assert(reinterpret_cast<uintptr_t>(memory) % kHugePageSize == 0);
+#if defined(MADV_HUGEPAGE)
+    // Just a hint, the benchmark still runs with the default pages
+    madvise(memory, memory_size, MADV_HUGEPAGE);
+#endif
+  }
+  std::fill(memory, memory + memory_size, std::byte{0});
+  if (!colored && set_stride > kPageSize &&
+      !huge_page_backed(memory, memory_size)) {
+    state.SetLabel("no PFNs or huge pages, virtual stride");
+  }
+
+  // Keep the sequence in the middle of the first page, so it does not
+  // compete with the benchmarked cache lines for the same set
+  const auto sequence = reinterpret_cast<uint32_t *>(&memory[kPageSize / 2]);
+  assert(lines.size() * sizeof(uint32_t) <= kPageSize / 2);
+  for (size_t i = 0; i < lines.size(); i++) {
+    sequence[i] = lines[i] * set_stride;
+  }
+
+  const auto num_ops = 1_M / lines.size() * lines.size();
+  while (state.KeepRunningBatch(num_ops)) {
+    benchmark::DoNotOptimize(
+        traverse_sequence(memory, sequence, lines.size(), num_ops));
+  }
+
+  if (colored) {
+    munmap(memory, memory_size);
+  } else {
+    operator delete(memory, std::align_val_t(kHugePageSize));
+  }
+
+  state.counters["Lines"] = num_lines;
+}
+
+//
+// Generate replacement policy benchmark arguments: a set stride
+// for each cache level times the number of lines in the set.
+//
+// The 4 KB stride maps all the lines to the same L1 set,
+// 64 KB and 128 KB strides map the lines to the same set
+// of 1024-set (256 KB-1 MB) and 2048-set (1-2 MB) L2 caches.
+//
+// There is no L3 stride: the L3 slice is selected by an undocumented
+// hash of the physical address, so the lines of any stride spread over
+// the slices and never fill a single L3 set.
+//
+static void replacement_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"stride KB", "lines"});
+  for (auto set_stride : {4, 64, 128}) {
+    for (auto lines = 2; lines <= 32; lines++) b->Args({set_stride, lines});
+  }
+}
+
+//
+// Cyclic access to N lines of the same set.
+//
+// Once N exceeds the number of ways W, LRU misses on every access,
+// tree-PLRU keeps missing on most of the accesses, while adaptive
+// policies (RRIP, set-dueling) keep a part of the lines, so the latency
+// grows gradually with N.
+//
+static void replacement_cyclic_array(benchmark::State &state) {
+  const auto set_stride = operator""_KB(state.range(0));
+  const auto num_lines = operator""_B(state.range(1));
+
+  std::vector<size_t> lines(num_lines);
+  std::iota(lines.begin(), lines.end(), 0);
+  benchmark_sequence(state, set_stride, lines);
+}
+BENCHMARK(replacement_cyclic_array)->Apply(replacement_args);
+
+//
+// Fill the set, re-reference a line in the middle, insert a new line
+// and probe which of the old lines got evicted.
+//
+// Each round flushes the set with W other lines, fills it with lines
+// 0 to W-1 in order, touches line W/2 again, inserts line W and finally
+// probes line P. Only the probe differs between the runs, so the probe
+// with the highest latency is the evicted line:
+// - LRU evicts line 0, the least recently used one;
+// - tree-PLRU evicts line 1: the flush returns the tree bits to their
+//   previous state, so the fill places lines 0 to W-1 in victim order,
+//   alternating the halves of the set. Line W/2 shares the half with
+//   line 0, so its re-reference points the tree to the other half,
+//   where line 1 is the next victim;
+// - adaptive policies (RRIP) evict the line W-1 inserted last or
+//   keep probing the same latency for all the lines.
+//
+static void replacement_eviction_array(benchmark::State &state) {
+  const auto set_stride = operator""_KB(state.range(0));
+  const auto ways = operator""_B(state.range(1));
+  const auto probe = operator""_B(state.range(2));
+
+  std::vector<size_t> lines;
+  for (size_t line = ways + 1; line <= 2 * ways; line++) lines.push_back(line);
+  for (size_t line = 0; line < ways; line++) lines.push_back(line);
+  lines.push_back(ways / 2);
+  lines.push_back(ways);
+  lines.push_back(probe);
+  benchmark_sequence(state, set_stride, lines);
+
+  // A single probe per round, so compare the rounds, not the accesses
+  state.counters["Round Time"] = benchmark::Counter(
+      double(state.iterations()) / lines.size(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+}
+
+//
+// Generate eviction probe arguments: a set stride for each cache level
+// times the typical number of ways times the lines the policies evict
+// (0, 1 and W-1) and the re-referenced line W/2 as a hit baseline.
+//
+static void replacement_eviction_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"stride KB", "ways", "probe"});
+  for (auto set_stride : {4, 64, 128}) {
+    for (auto ways : {8, 12, 16}) {
+      for (auto probe : {0, 1, ways / 2, ways - 1})
+        b->Args({set_stride, ways, probe});
+    }
+  }
+}
+BENCHMARK(replacement_eviction_array)->Apply(replacement_eviction_args);
+
+//
+// Access H hot lines of the set a few times, then scan S other lines once.
+//
+// With H + S above the number of ways, LRU evicts the hot lines
+// on each scan, while scan-resistant policies (RRIP) insert the scanned
+// lines with a distant re-reference prediction and keep the hot lines.
+//
+static void replacement_scan_array(benchmark::State &state) {
+  const auto set_stride = operator""_KB(state.range(0));
+  const auto hot_lines = operator""_B(state.range(1));
+  const auto scan_lines = operator""_B(state.range(2));
+  const auto hot_passes = 4;
+
+  std::vector<size_t> lines;
+  for (auto pass = 0; pass < hot_passes; pass++) {
+    for (size_t line = 0; line < hot_lines; line++) lines.push_back(line);
+  }
+  for (size_t line = 0; line < scan_lines; line++) {
+    lines.push_back(hot_lines + line);
+  }
+  benchmark_sequence(state, set_stride, lines);
+}
+BENCHMARK(replacement_scan_array)
+    ->ArgNames({"stride KB", "hot", "scan"})
+    ->ArgsProduct({{4, 64, 128}, {4, 8}, {0, 4, 8, 16, 32, 64}})
+    //
+    ;
+
 ////////////////////////////////////////////////////////////////////////
 // Hardware Prefetch
 ////////////////////////////////////////////////////////////////////////
@@ -519,6 +1256,208 @@ BENCHMARK(hardware_prefetch_list)
 //       benchmark::Counter::OneK::kIs1024);
 // }
 
+////////////////////////////////////////////////////////////////////////
+// Hardware Prefetch Patterns
+////////////////////////////////////////////////////////////////////////
+
+static void prefetch_streams_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+  const auto streams = operator""_B(state.range(1));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+  const auto list_nodes = list_size / sizeof(CachelineAlignedListNode);
+  const auto stream_nodes = list_nodes / streams;
+  // Skew each region by a cache line, so the same line of each stream
+  // maps to a different set and the streams do not evict each other
+  const auto region_size = stream_nodes * kCachelineSize + kCachelineSize;
+
+  // Split the memory block into regions, one per forward stream,
+  // and visit the streams in a round-robin fashion
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < stream_nodes; i++) {
+    for (size_t stream = 0; stream < streams; stream++) {
+      offsets.push_back(stream * region_size + i * kCachelineSize);
+    }
+  }
+  benchmark_list_at<CachelineAlignedListNode>(
+      state, streams * region_size, offsets, offsets.size(),
+      [](CachelineAlignedListNode *) {});
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(prefetch_streams_list)
+    ->ArgNames({"size KB", "streams"})
+    ->Args({1_KB, 1})
+    ->Args({1_KB, 2})
+    ->Args({1_KB, 4})
+    ->Args({1_KB, 8})
+    ->Args({1_KB, 16})
+    ->Args({1_KB, 24})
+    ->Args({1_KB, 32})
+    ->Args({1_KB, 48})
+    ->Args({1_KB, 64})
+
+    ->Args({16_KB, 1})
+    ->Args({16_KB, 2})
+    ->Args({16_KB, 4})
+    ->Args({16_KB, 8})
+    ->Args({16_KB, 16})
+    ->Args({16_KB, 24})
+    ->Args({16_KB, 32})
+    ->Args({16_KB, 48})
+    ->Args({16_KB, 64})
+    //
+    ;
+
+static void prefetch_backward_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+  const auto stride = operator""_B(state.range(1));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+  const auto list_nodes = list_size / sizeof(CachelineAlignedListNode);
+
+  // Start at the end of the memory block and walk down
+  std::vector<size_t> offsets;
+  for (size_t i = list_nodes; i > 0; i--) offsets.push_back((i - 1) * stride);
+  benchmark_list_at<CachelineAlignedListNode>(
+      state, list_nodes * stride, offsets, offsets.size(),
+      [](CachelineAlignedListNode *) {});
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(prefetch_backward_list)
+    ->ArgNames({"size KB", "stride"})
+    ->Args({1_KB, kPageSize / 64})
+    ->Args({1_KB, kPageSize / 32})
+    ->Args({1_KB, kPageSize / 16})
+    ->Args({1_KB, kPageSize / 8})
+    ->Args({1_KB, kPageSize / 4})
+    ->Args({1_KB, kPageSize / 2})
+    ->Args({1_KB, kPageSize})
+    ->Args({1_KB, kPageSize + kCachelineSize})
+
+    ->Args({16_KB, kPageSize / 64})
+    ->Args({16_KB, kPageSize / 32})
+    ->Args({16_KB, kPageSize / 16})
+    ->Args({16_KB, kPageSize / 8})
+    ->Args({16_KB, kPageSize / 4})
+    ->Args({16_KB, kPageSize / 2})
+    ->Args({16_KB, kPageSize})
+    ->Args({16_KB, kPageSize + kCachelineSize})
+    //
+    ;
+
+static void prefetch_zigzag_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+  const auto run = operator""_B(state.range(1));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+  const auto list_nodes = list_size / sizeof(CachelineAlignedListNode);
+  assert(list_nodes % run == 0);
+
+  // Walk the runs of adjacent cache lines alternating the direction:
+  // the even runs are walked up, the odd runs are walked down
+  std::vector<size_t> offsets;
+  for (size_t run_start = 0; run_start < list_nodes; run_start += run) {
+    const auto backward = (run_start / run) % 2;
+    for (size_t i = 0; i < run; i++) {
+      const auto node = backward ? run_start + run - 1 - i : run_start + i;
+      offsets.push_back(node * kCachelineSize);
+    }
+  }
+  benchmark_list_at<CachelineAlignedListNode>(
+      state, list_size, offsets, offsets.size(),
+      [](CachelineAlignedListNode *) {});
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(prefetch_zigzag_list)
+    ->ArgNames({"size KB", "run"})
+    ->Args({1_KB, 2})
+    ->Args({1_KB, 4})
+    ->Args({1_KB, 8})
+    ->Args({1_KB, 16})
+    ->Args({1_KB, 64})
+    ->Args({1_KB, 256})
+
+    ->Args({16_KB, 2})
+    ->Args({16_KB, 4})
+    ->Args({16_KB, 8})
+    ->Args({16_KB, 16})
+    ->Args({16_KB, 64})
+    ->Args({16_KB, 256})
+    //
+    ;
+
+static void prefetch_page_boundary_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+  const auto stride = operator""_B(state.range(1));
+  const auto window = operator""_B(state.range(2));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+  const auto list_nodes = list_size / sizeof(CachelineAlignedListNode);
+  const auto memory_size = list_nodes * stride;
+  const auto pages = memory_size / kPageSize;
+  assert(memory_size % kPageSize == 0);
+
+  // Walk the pages in order, so the stream continues over the page edges,
+  // or shuffle the pages within a window, so each page edge breaks
+  // the stream. A window of one page keeps the order, a window of zero
+  // shuffles the whole block. The windows fitting the TLB keep the page
+  // walks local, so the difference with the in-order walk is just
+  // the prefetcher stopping at the page edges
+  const auto window_pages = window == 0 ? pages : std::min(window, pages);
+  std::vector<size_t> page_order(pages);
+  std::iota(page_order.begin(), page_order.end(), 0);
+  // Use a fixed seed, so the runs are reproducible
+  std::mt19937_64 random(42);
+  for (size_t first = 0; first < pages; first += window_pages) {
+    const auto last = std::min(first + window_pages, pages);
+    std::shuffle(&page_order[first], &page_order[0] + last, random);
+  }
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < list_nodes; i++) {
+    const auto offset = i * stride;
+    const auto page = page_order[offset / kPageSize];
+    offsets.push_back(page * kPageSize + offset % kPageSize);
+  }
+  benchmark_list_at<CachelineAlignedListNode>(
+      state, memory_size, offsets, offsets.size(),
+      [](CachelineAlignedListNode *) {});
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(prefetch_page_boundary_list)
+    ->ArgNames({"size KB", "stride", "window"})
+    // Windows: in order, L1 DTLB (64 entries), STLB (1536 entries), all
+    ->ArgsProduct({{16_KB},
+                   {kPageSize / 64, kPageSize / 32, kPageSize / 16,
+                    kPageSize / 4, kPageSize / 2 + kCachelineSize,
+                    kPageSize - kCachelineSize},
+                   {1, 32, 1_KB, 0}})
+    //
+    ;
+
 ////////////////////////////////////////////////////////////////////////
 // Cache Hierarchy
 ////////////////////////////////////////////////////////////////////////
@@ -588,6 +1527,93 @@ BENCHMARK(cache_hierarchy_array)
     //
     ;
 
+////////////////////////////////////////////////////////////////////////
+// Node Size
+////////////////////////////////////////////////////////////////////////
+
+// Cache lines of a list node touched on each visit
+enum NodeTouch { kTouchFirst, kTouchFirstLast, kTouchAll };
+
+// Cacheline aligned list node spanning a few cache lines
+template <size_t kNodeSize>
+struct alignas(kCachelineSize) WideListNode {
+  static constexpr auto kLines = kNodeSize / kCachelineSize;
+  static constexpr auto kLineWords = kCachelineSize / sizeof(uint64_t);
+
+  WideListNode *next;
+  uint64_t fields[kLines * kLineWords - 1];
+
+  // Get the first field of a cache line. The first line starts with `next`
+  auto field(size_t line) const { return fields[line * kLineWords - 1]; }
+};
+
+//
+// Generate node size benchmark arguments: the list sizes of
+// the `cache_hierarchy_list`.
+//
+static void node_size_args(benchmark::internal::Benchmark *b) {
+  b->ArgName("size KB");
+  for (auto size : {8, 16, 32, 64, 128, 256, 512}) b->Arg(size);
+  for (auto size : {1_KB, 2_KB, 4_KB, 8_KB, 16_KB}) b->Arg(size);
+}
+
+template <size_t kNodeSize, NodeTouch touch>
+static void node_size_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+
+  using ListNode = WideListNode<kNodeSize>;
+  static_assert(sizeof(ListNode) == kNodeSize);
+  constexpr auto kLastLine = ListNode::kLines - 1;
+  const auto touched_lines = touch == kTouchAll        ? kLastLine + 1
+                             : touch == kTouchFirstLast ? (kLastLine ? 2 : 1)
+                                                        : 1;
+
+  // Read a field from each touched line. The first line is always
+  // touched by the `next` pointer, so read a field from the rest
+  benchmark_list<ListNode>(
+      state, list_size, 1_M, 1_M, kPageSize + kNodeSize, 0,
+      [](ListNode *node) {
+        if constexpr (touch == kTouchFirstLast && kLastLine > 0) {
+          benchmark::DoNotOptimize(node->field(kLastLine));
+        } else if constexpr (touch == kTouchAll) {
+          for (size_t line = 1; line < ListNode::kLines; line++)
+            benchmark::DoNotOptimize(node->field(line));
+        }
+      });
+
+  state.counters["Lines"] = touched_lines;
+  state.counters["Line Time"] = benchmark::Counter(
+      state.iterations() * touched_lines,
+      benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters[" Read Rate"] = benchmark::Counter(
+      state.iterations() * touched_lines * kCachelineSize,
+      benchmark::Counter::kIsRate, benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK_TEMPLATE(node_size_list, 64, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 64, kTouchFirstLast)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 64, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 128, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 128, kTouchFirstLast)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 128, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 256, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 256, kTouchFirstLast)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 256, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 512, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 512, kTouchFirstLast)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 512, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 1024, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 1024, kTouchFirstLast)
+    ->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 1024, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 2048, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 2048, kTouchFirstLast)
+    ->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 2048, kTouchAll)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 4096, kTouchFirst)->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 4096, kTouchFirstLast)
+    ->Apply(node_size_args);
+BENCHMARK_TEMPLATE(node_size_list, 4096, kTouchAll)->Apply(node_size_args);
+
 ////////////////////////////////////////////////////////////////////////
 // TLB Hierarchy
 ////////////////////////////////////////////////////////////////////////
@@ -712,4 +1738,384 @@ BENCHMARK(cache_conflicts_array)
     //
     ;
 
+////////////////////////////////////////////////////////////////////////
+// NUMA
+////////////////////////////////////////////////////////////////////////
+
+// CPU affinity mask of the thread saved before binding it
+struct ThreadAffinity {
+#if defined(__linux__)
+  cpu_set_t cpu_set;
+#endif
+  bool saved = false;
+};
+
+//
+// Bind the calling thread to the CPUs of NUMA nodes.
+//
+// @param cpu_nodes
+//   NUMA nodes to run the thread on.
+// @param affinity
+//   Thread affinity to save the current mask to, so it can be restored
+//   with `restore_thread`.
+//
+// @return
+//   True on success.
+//
+static bool bind_thread(const std::vector<int> &cpu_nodes,
+                        ThreadAffinity &affinity) {
+#if defined(__linux__)
+  affinity.saved = sched_getaffinity(0, sizeof(affinity.cpu_set),
+                                     &affinity.cpu_set) == 0;
+  if (!affinity.saved) return false;
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (auto node : cpu_nodes) {
+    const auto cpus = read_sysfs_list("/sys/devices/system/node/node" +
+                                      std::to_string(node) + "/cpulist");
+    for (auto cpu : cpus) CPU_SET(cpu, &cpu_set);
+  }
+  if (CPU_COUNT(&cpu_set) == 0) return false;
+  return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+#else
+  (void)cpu_nodes, (void)affinity;
+  return false;
+#endif
+}
+
+//
+// Restore the thread affinity mask saved by `bind_thread`.
+//
+static void restore_thread(const ThreadAffinity &affinity) {
+#if defined(__linux__)
+  if (affinity.saved)
+    sched_setaffinity(0, sizeof(affinity.cpu_set), &affinity.cpu_set);
+#else
+  (void)affinity;
+#endif
+}
+
+//
+// Generate NUMA benchmark arguments: each pair of CPU and memory nodes,
+// and the memory interleaved over all the nodes (`mem node:-2`).
+//
+// On a single node machine just the local case is benchmarked.
+//
+static void numa_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"size KB", "cpu node", "mem node"});
+  const auto nodes = numa_nodes();
+  const auto size = 256_KB;
+  for (auto cpu_node : nodes) {
+    for (auto mem_node : nodes) b->Args({size, cpu_node, mem_node});
+    if (nodes.size() > 1) b->Args({size, cpu_node, kInterleaveNodes});
+  }
+}
+
+static void numa_latency_list(benchmark::State &state) {
+  const auto list_size = operator""_KB(state.range(0));
+  const auto cpu_node = static_cast<int>(state.range(1));
+  const auto mem_node = static_cast<int>(state.range(2));
+
+  // Cacheline aligned singly linked list node
+  struct alignas(kCachelineSize) CachelineAlignedListNode {
+    CachelineAlignedListNode *next;
+  };
+  const auto list_nodes = list_size / sizeof(CachelineAlignedListNode);
+
+  ThreadAffinity affinity;
+  if (!bind_thread({cpu_node}, affinity)) state.SetLabel("thread is not bound");
+  benchmark_list<CachelineAlignedListNode>(
+      state, list_size, list_nodes, 1_M, kPageSize + kCachelineSize, 0,
+      [](CachelineAlignedListNode *) {}, mem_node);
+  restore_thread(affinity);
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(numa_latency_list)->Apply(numa_args);
+
+static void numa_bandwidth_array(benchmark::State &state) {
+  const auto array_size = operator""_KB(state.range(0));
+  const auto cpu_node = static_cast<int>(state.range(1));
+  const auto mem_node = static_cast<int>(state.range(2));
+
+  // Cacheline aligned array element
+  struct alignas(kCachelineSize) CachelineAlignedArrayElement {
+    volatile uint64_t offset;
+  };
+  const auto array_elements = array_size / sizeof(CachelineAlignedArrayElement);
+
+  ThreadAffinity affinity;
+  if (!bind_thread({cpu_node}, affinity)) state.SetLabel("thread is not bound");
+  benchmark_array<CachelineAlignedArrayElement>(
+      state, array_size, array_elements, array_elements, kCachelineSize, 0,
+      [](CachelineAlignedArrayElement *) {}, mem_node);
+  restore_thread(affinity);
+
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * kCachelineSize, benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+BENCHMARK(numa_bandwidth_array)->Apply(numa_args);
+
+////////////////////////////////////////////////////////////////////////
+// Gather Loads
+////////////////////////////////////////////////////////////////////////
+
+// Stride value to request a random permutation of indices
+const auto kRandomStride = 0_B;
+
+// Instruction set used to load the indexed elements
+enum GatherIsa { kScalar, kAvx2, kAvx512 };
+
+//
+// Make an array of indices to load from a table with the specified stride.
+//
+// The indices follow the same placement as `place_array_elements`:
+// once the end of the table is reached, the next pass starts at
+// the next element after the previous pass start.
+//
+// @tparam Index
+//   Index type.
+//
+// @param table_size
+//   Total table size in bytes.
+// @param element_size
+//   Table element size in bytes.
+// @param stride
+//   Distance in bytes between adjacent indexed elements,
+//   or `kRandomStride` for a random permutation of all the elements.
+//
+// @return
+//   Array of indices covering each table element once.
+//
+template <class Index>
+static auto make_indices(const size_t table_size, const size_t element_size,
+                         const size_t stride) {
+  const auto num_elements = table_size / element_size;
+  assert(num_elements > 0);
+
+  std::vector<Index> indices;
+  indices.reserve(num_elements);
+  if (stride == kRandomStride) {
+    indices.resize(num_elements);
+    std::iota(indices.begin(), indices.end(), 0);
+    // Use a fixed seed, so the runs are reproducible
+    std::shuffle(indices.begin(), indices.end(), std::mt19937_64(42));
+    return indices;
+  }
+  // Make sure the stride is a multiple of the element size
+  assert(stride % element_size == 0);
+  assert(stride <= table_size);
+  for (size_t stride_offset = 0; stride_offset < stride;
+       stride_offset += element_size) {
+    for (size_t offset = stride_offset; offset < table_size; offset += stride) {
+      indices.push_back(offset / element_size);
+    }
+  }
+  return indices;
+}
+
+//
+// Sum up the indexed table elements using scalar loads.
+//
+// @param table
+//   Table of elements to load from.
+// @param indices
+//   Array of indices to load.
+// @param num_indices
+//   Number of indices in the array.
+//
+template <class Element>
+static auto gather_scalar(const Element *table, const Element *indices,
+                          const size_t num_indices) {
+  Element sum = 0;
+  for (size_t i = 0; i < num_indices; i++) sum += table[indices[i]];
+  return sum;
+}
+
+#if defined(__x86_64__)
+
+//
+// Sum up the indexed table elements using AVX2 `vpgatherdd`.
+//
+__attribute__((target("avx2"))) static auto gather_avx2(
+    const uint32_t *table, const uint32_t *indices, const size_t num_indices) {
+  const auto kLanes = sizeof(__m256i) / sizeof(uint32_t);
+  auto vsum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + kLanes <= num_indices; i += kLanes) {
+    const auto vindices =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&indices[i]));
+    const auto velements = _mm256_i32gather_epi32(
+        reinterpret_cast<const int *>(table), vindices, sizeof(uint32_t));
+    vsum = _mm256_add_epi32(vsum, velements);
+  }
+  alignas(sizeof(__m256i)) uint32_t lanes[kLanes];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), vsum);
+  auto sum = gather_scalar(table, &indices[i], num_indices - i);
+  for (auto lane : lanes) sum += lane;
+  return sum;
+}
+
+//
+// Sum up the indexed table elements using AVX2 `vpgatherqq`.
+//
+__attribute__((target("avx2"))) static auto gather_avx2(
+    const uint64_t *table, const uint64_t *indices, const size_t num_indices) {
+  const auto kLanes = sizeof(__m256i) / sizeof(uint64_t);
+  auto vsum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + kLanes <= num_indices; i += kLanes) {
+    const auto vindices =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&indices[i]));
+    const auto velements = _mm256_i64gather_epi64(
+        reinterpret_cast<const long long *>(table), vindices,
+        sizeof(uint64_t));
+    vsum = _mm256_add_epi64(vsum, velements);
+  }
+  alignas(sizeof(__m256i)) uint64_t lanes[kLanes];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), vsum);
+  auto sum = gather_scalar(table, &indices[i], num_indices - i);
+  for (auto lane : lanes) sum += lane;
+  return sum;
+}
+
+//
+// Sum up the indexed table elements using AVX-512 `vpgatherdd`.
+//
+__attribute__((target("avx512f"))) static auto gather_avx512(
+    const uint32_t *table, const uint32_t *indices, const size_t num_indices) {
+  const auto kLanes = sizeof(__m512i) / sizeof(uint32_t);
+  auto vsum = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + kLanes <= num_indices; i += kLanes) {
+    const auto vindices = _mm512_loadu_si512(&indices[i]);
+    const auto velements =
+        _mm512_i32gather_epi32(vindices, table, sizeof(uint32_t));
+    vsum = _mm512_add_epi32(vsum, velements);
+  }
+  uint32_t sum = _mm512_reduce_add_epi32(vsum);
+  return sum + gather_scalar(table, &indices[i], num_indices - i);
+}
+
+//
+// Sum up the indexed table elements using AVX-512 `vpgatherqq`.
+//
+__attribute__((target("avx512f"))) static auto gather_avx512(
+    const uint64_t *table, const uint64_t *indices, const size_t num_indices) {
+  const auto kLanes = sizeof(__m512i) / sizeof(uint64_t);
+  auto vsum = _mm512_setzero_si512();
+  size_t i = 0;
+  for (; i + kLanes <= num_indices; i += kLanes) {
+    const auto vindices = _mm512_loadu_si512(&indices[i]);
+    const auto velements =
+        _mm512_i64gather_epi64(vindices, table, sizeof(uint64_t));
+    vsum = _mm512_add_epi64(vsum, velements);
+  }
+  uint64_t sum = _mm512_reduce_add_epi64(vsum);
+  return sum + gather_scalar(table, &indices[i], num_indices - i);
+}
+
+#endif  // __x86_64__
+
+//
+// Check if the CPU we are running on supports the instruction set.
+//
+static auto gather_isa_supported(const GatherIsa isa) {
+#if defined(__x86_64__)
+  switch (isa) {
+    case kScalar:
+      return true;
+    case kAvx2:
+      return __builtin_cpu_supports("avx2") != 0;
+    case kAvx512:
+      return __builtin_cpu_supports("avx512f") != 0;
+  }
+  return false;
+#else
+  return isa == kScalar;
+#endif
+}
+
+template <class Element, GatherIsa isa>
+static void gather_array(benchmark::State &state) {
+  const auto table_size = operator""_KB(state.range(0));
+  const auto stride = operator""_B(state.range(1));
+
+  if (!gather_isa_supported(isa)) {
+    state.SkipWithError("Instruction set is not supported by the CPU");
+    return;
+  }
+
+  // Allocate an aligned table of elements
+  const auto num_elements = table_size / sizeof(Element);
+  auto table = static_cast<Element *>(
+      operator new(table_size, std::align_val_t(kPageSize)));
+  std::iota(table, table + num_elements, 0);
+  const auto indices =
+      make_indices<Element>(table_size, sizeof(Element), stride);
+  const auto num_ops = indices.size();
+
+  while (state.KeepRunningBatch(num_ops)) {
+    if constexpr (isa == kScalar) {
+      benchmark::DoNotOptimize(
+          gather_scalar(table, indices.data(), indices.size()));
+#if defined(__x86_64__)
+    } else if constexpr (isa == kAvx2) {
+      benchmark::DoNotOptimize(
+          gather_avx2(table, indices.data(), indices.size()));
+    } else if constexpr (isa == kAvx512) {
+      benchmark::DoNotOptimize(
+          gather_avx512(table, indices.data(), indices.size()));
+#endif
+    }
+  }
+
+  operator delete(table, std::align_val_t(kPageSize));
+
+  // Giga elements per second is the same as elements per nanosecond
+  state.counters["Element Rate"] = benchmark::Counter(
+      state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["Read Rate"] = benchmark::Counter(
+      state.iterations() * sizeof(Element), benchmark::Counter::kIsRate,
+      benchmark::Counter::OneK::kIs1024);
+}
+
+//
+// Generate gather benchmark arguments: footprints from L1 to DRAM
+// times sequential, strided and random index patterns.
+//
+template <class Element>
+static void gather_array_args(benchmark::internal::Benchmark *b) {
+  b->ArgNames({"size KB", "stride"});
+  const size_t sizes[] = {8, 128, 1_KB, 8_KB, 64_KB};
+  const size_t strides[] = {sizeof(Element),
+                            kCachelineSize,
+                            kCachelineSize * 2,
+                            kPageSize / 16,
+                            kPageSize / 4,
+                            kPageSize,
+                            kPageSize + kCachelineSize,
+                            kRandomStride};
+  for (auto size : sizes) {
+    for (auto stride : strides) {
+      b->Args({static_cast<int64_t>(size), static_cast<int64_t>(stride)});
+    }
+  }
+}
+BENCHMARK_TEMPLATE(gather_array, uint32_t, kScalar)
+    ->Apply(gather_array_args<uint32_t>);
+BENCHMARK_TEMPLATE(gather_array, uint32_t, kAvx2)
+    ->Apply(gather_array_args<uint32_t>);
+BENCHMARK_TEMPLATE(gather_array, uint32_t, kAvx512)
+    ->Apply(gather_array_args<uint32_t>);
+BENCHMARK_TEMPLATE(gather_array, uint64_t, kScalar)
+    ->Apply(gather_array_args<uint64_t>);
+BENCHMARK_TEMPLATE(gather_array, uint64_t, kAvx2)
+    ->Apply(gather_array_args<uint64_t>);
+BENCHMARK_TEMPLATE(gather_array, uint64_t, kAvx512)
+    ->Apply(gather_array_args<uint64_t>);
+
 BENCHMARK_MAIN();